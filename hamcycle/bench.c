@@ -0,0 +1,86 @@
+// Garrett Tanzer
+// zk hash backend benchmark
+
+#include "zklib.h"
+
+#include <time.h>
+
+
+// bench(id, count, entries, digests)
+//  hash `count` entries with backend `id`
+//  returns the elapsed time in seconds
+
+//  `id`        hash backend
+//  `count`     number of entries
+//  `entries`   count item matrix of 32-byte entries
+//  `digests`   count item matrix to be filled with 256-bit hashes
+
+double bench(uint8_t id, uint64_t count, uint8_t (*entries)[32], uint8_t (*digests)[32]) {
+
+    hash_select(id);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint64_t i = 0; i < count; i++) {
+        hash32(entries[i], digests[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+
+int main(int argc, char **argv) {
+
+    // ------ command line arguments -------------------------------------------
+
+    // `bench [n] [reps]` times `reps` dense n x n commitments per backend
+    uint64_t n = 1000;
+    uint64_t reps = 5;
+    if(argc >= 2) {
+        n = strtol(argv[1], NULL, 10);
+    }
+    if(argc >= 3) {
+        reps = strtol(argv[2], NULL, 10);
+    }
+    if(n == 0 || reps == 0) {
+        printf("usage: bench [n] [reps]\n");
+        _exit(1);
+    }
+
+    uint64_t count = n * n;
+    uint8_t (*entries)[32] = (uint8_t (*)[32]) malloc(count * 32);
+    uint8_t (*digests)[32] = (uint8_t (*)[32]) malloc(count * 32);
+
+    random_init(1UL << 16);
+    random_fill(count * 32, entries[0]);
+
+    // ------ time each backend ------------------------------------------------
+
+    printf("n = %llu, %llu hashes per commitment, best of %llu\n\n", n, count, reps);
+    printf("%-10s %12s %10s\n", "hash", "ms/commit", "ns/hash");
+
+    for(uint8_t id = 0; id < NHASHES; id++) {
+        if(!hash_supported(id)) {
+            printf("%-10s %12s %10s\n", hash_names[id], "-", "-");
+            continue;
+        }
+
+        double best = bench(id, count, entries, digests);
+        for(uint64_t r = 1; r < reps; r++) {
+            double t = bench(id, count, entries, digests);
+            if(t < best) {
+                best = t;
+            }
+        }
+
+        printf("%-10s %12.3f %10.1f\n", hash_names[id], best * 1e3, best * 1e9 / count);
+    }
+
+    free(entries);
+    free(digests);
+    random_free();
+    hash_free();
+
+    return 0;
+}
@@ -0,0 +1,188 @@
+// Garrett Tanzer
+// zk random instance generator
+
+#include "zklib.h"
+
+#include <math.h>
+
+
+// ------ prng -----------------------------------------------------------------
+
+// splitmix64, so that a seed reproduces the same instance (given the same libm,
+// since skip() goes through log())
+static uint64_t state;
+
+uint64_t next64(void) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// uniform in (0, 1]
+double next_unit(void) {
+    return ((next64() >> 11) + 1) * 0x1.0p-53;
+}
+
+
+// skip(p)
+//  returns the number of non-edges before the next edge, so that a row costs
+//  O(expected degree) rather than O(n) draws
+
+//  `p`     edge probability
+
+uint64_t skip(double p) {
+    if(p >= 1) {
+        return 0;
+    }
+    double s = floor(log(next_unit()) / log1p(-p));
+    return s >= (double) UINT64_MAX ? UINT64_MAX : (uint64_t) s;
+}
+
+
+// write_graph(out, n, p, succ, packed)
+//  streams a random directed graph in the verifier's input format, one row at
+//  a time, containing every edge i -> succ[i] plus each other edge with
+//  probability p
+
+//  `out`       output stream
+//  `n`         number of vertices
+//  `p`         edge probability
+//  `succ`      n item array, successor of each vertex on the planted cycle
+//  `packed`    1 to write each row without separators, at half the size
+
+void write_graph(FILE *out, uint64_t n, double p, uint64_t *succ, uint8_t packed) {
+
+    // entry j of a row is at row[stride*j], followed by a space unless packed
+    uint64_t stride = packed ? 1 : 2;
+    uint64_t width = packed ? n + 1 : 2 * n;
+    char *row = malloc(width);
+    uint64_t *set = malloc((n+1) * sizeof(uint64_t));
+    for(uint64_t j = 0; j < n; j++) {
+        row[stride*j] = '0';
+        if(!packed) {
+            row[2*j+1] = ' ';
+        }
+    }
+    row[width-1] = '\n';
+
+    fprintf(out, "%llu\n", n);
+    for(uint64_t i = 0; i < n; i++) {
+        uint64_t nset = 0;
+        set[nset++] = succ[i];
+        uint64_t j = skip(p);
+        while(j < n) {
+            set[nset++] = j;
+            uint64_t s = skip(p);
+            if(s >= n - j) {
+                break;
+            }
+            j += s + 1;
+        }
+
+        for(uint64_t k = 0; k < nset; k++) {
+            row[stride*set[k]] = '1';
+        }
+        fwrite(row, 1, width, out);
+
+        // clear only the entries that were set
+        for(uint64_t k = 0; k < nset; k++) {
+            row[stride*set[k]] = '0';
+        }
+    }
+
+    free(row);
+    free(set);
+}
+
+
+int main(int argc, char **argv) {
+
+    // ------ command line arguments -------------------------------------------
+
+    // `gen [-p] [-s seed] n density graph.txt cycle.txt`
+    uint64_t seed = 0;
+    int seeded = 0;
+    uint8_t packed = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "ps:")) != -1) {
+        if(opt == 's') {
+            seed = strtoull(optarg, NULL, 10);
+            seeded = 1;
+        }
+        else if(opt == 'p') {
+            packed = 1;
+        }
+        else {
+            printf("usage: gen [-p] [-s seed] n density graph.txt cycle.txt\n");
+            _exit(1);
+        }
+    }
+    if(argc - optind != 4) {
+        printf("usage: gen [-p] [-s seed] n density graph.txt cycle.txt\n");
+        _exit(1);
+    }
+
+    uint64_t n = strtoull(argv[optind], NULL, 10);
+    double p = strtod(argv[optind+1], NULL);
+    if(n < 2 || !(p >= 0 && p <= 1)) {
+        printf("need n >= 2 and 0 <= density <= 1\n");
+        _exit(1);
+    }
+
+    if(!seeded) {
+        random_init(8);
+        seed = random64();
+        random_free();
+    }
+    state = seed;
+
+    FILE *graph_file = fopen(argv[optind+2], "w");
+    FILE *cycle_file = fopen(argv[optind+3], "w");
+    if(graph_file == NULL || cycle_file == NULL) {
+        perror("fopen() failed");
+        _exit(1);
+    }
+    setvbuf(graph_file, NULL, _IOFBF, 1 << 20);
+    setvbuf(cycle_file, NULL, _IOFBF, 1 << 20);
+
+    // ------ plant a random hamiltonian cycle ---------------------------------
+
+    uint64_t *cycle = malloc((n+1) * sizeof(uint64_t));
+    for(uint64_t i = 0; i < n; i++) {
+        cycle[i] = i;
+    }
+    for(uint64_t i = n-1; i > 0; i--) {
+        uint64_t j = next64() % (i+1);
+        uint64_t tmp = cycle[i];
+        cycle[i] = cycle[j];
+        cycle[j] = tmp;
+    }
+    cycle[n] = cycle[0];
+
+    uint64_t *succ = malloc(n * sizeof(uint64_t));
+    for(uint64_t i = 0; i < n; i++) {
+        succ[cycle[i]] = cycle[i+1];
+    }
+
+    // ------ write instance ---------------------------------------------------
+
+    write_graph(graph_file, n, p, succ, packed);
+
+    fprintf(cycle_file, "%llu\n", n);
+    for(uint64_t i = 0; i < n+1; i++) {
+        fprintf(cycle_file, i < n ? "%llu " : "%llu\n", cycle[i]);
+    }
+
+    if(fclose(graph_file) != 0 || fclose(cycle_file) != 0) {
+        perror("fclose() failed");
+        _exit(1);
+    }
+
+    printf("seed %llu\n", seed);
+
+    free(cycle);
+    free(succ);
+
+    return 0;
+}
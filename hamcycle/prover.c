@@ -3,120 +3,165 @@
 
 #include "zklib.h"
 
+#include <signal.h>
+#include <time.h>
 
-// commit(n, graph, commitment, salts, permutation)
-//  randomly permute `graph`, choose random `salts`, and commit with SHA256
+// prove() challenge for a commitment that hasn't been challenged yet
+#define NO_CHALLENGE 0xFF
+
+
+// commit(n, d, graph, commitment, salts, permutation, order)
+//  randomly permute `graph`, choose random `salts`, and commit with `hash32`
 
 //  `n`             number of vertices
+//  `d`             row width (max out-degree of `graph`)
 //  `graph`         n x n adjacency matrix
-//  `commitment`    n x n matrix to be filled with 256-bit commitment hashes
-//  `salts`         n x n matrix to be filled with the preimage of `commitment`
+//  `commitment`    n x d matrix to be filled with 256-bit commitment hashes
+//  `salts`         n x d matrix to be filled with the preimage of `commitment`
 //  `permutation`   n item array to be filled with a vertex permutation
+//  `order`         d item array used to shuffle each row
 
-void commit(uint64_t n, uint8_t (*graph)[n], uint8_t (*commitment)[n][32], uint8_t (*salts)[n][32], uint64_t *permutation) {
+void commit(uint64_t n, uint64_t d, uint8_t (*graph)[n], uint8_t (*commitment)[d][32], uint8_t (*salts)[d][32], uint64_t *permutation, uint64_t *order) {
     
     // randomly select a vertex permutation
     permute(n, permutation);
     
     for(uint64_t i = 0; i < n; i++) {
+        uint64_t p = permutation[i];
+        
+        // shuffle the row so entry positions don't reveal columns
+        permute(d, order);
+        uint64_t t = 0;
+        
+        // pick a random salt + column + 1 for each edge
         for(uint64_t j = 0; j < n; j++) {
-            uint64_t p = permutation[i];
-            uint64_t q = permutation[j];
-            
-            // pick a random salt + {0, 1} for each edge
-            random_fill(32, &salts[p][q][0]);
-            salts[p][q][31] = graph[i][j];
-            
-            // commit that salt
-            (void) SHA256(&salts[p][q][0], 32, &commitment[p][q][0]);
+            if(graph[i][j] == 1) {
+                uint8_t *entry = salts[p][order[t++]];
+                random_fill(32, entry);
+                entry_set_col(entry, permutation[j]);
+                entry[ENTRY_BIT] = 1;
+            }
+        }
+        
+        // pad the row out to `d` entries with random salt + 0
+        for(; t < d; t++) {
+            uint8_t *entry = salts[p][order[t]];
+            random_fill(32, entry);
+            entry[ENTRY_BIT] = 0;
+        }
+        
+        // commit those salts
+        for(t = 0; t < d; t++) {
+            hash32(&salts[p][t][0], &commitment[p][t][0]);
         }
     }
 }
 
 
-// prove(conn, n, graph, cycle, commitment, salts, permutation)
-//  perform a single round of the zk hamiltonian cycle protocol as the prover
+// prove(conn, n, d, cycle, commitment, salts, permutation, pcycle, pindex, psalts, challenge)
+//  perform a single round of the zk hamiltonian cycle protocol as the prover,
+//  for a commitment from commit()
+//  returns 0 if the connection dropped
 
 //  `conn`          socket file descriptor
 //  `n`             number of vertices
-//  `graph`         n x n adjacency matrix
+//  `d`             row width (max out-degree of the graph)
 //  `cycle`         n+1 item array with the secret hamiltonian cycle
-//  `commitment`    n x n matrix to store 256-bit commitment hashes
-//  `salts`         n x n matrix to store the inversion of `commitments`
-//  `permutation`   n item array to store a random vertex permutation
+//  `commitment`    n x d matrix with 256-bit commitment hashes
+//  `salts`         n x d matrix with the inversion of `commitments`
+//  `permutation`   n item array with the vertex permutation
+//  `pcycle`        n+1 item array to store the permuted hamiltonian cycle
+//  `pindex`        n item array to store the entry index of each cycle edge
+//  `psalts`        n item matrix to store the salts of each cycle edge
+//  `challenge`     the b this commitment was already challenged with, or NO_CHALLENGE;
+//                  filled with the b received
 
-void prove(int64_t conn, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, uint8_t (*commitment)[n][32], uint8_t (*salts)[n][32], uint64_t *permutation) {
-    
-    // generate a commitment
-    commit(n, graph, commitment, salts, permutation);
+uint8_t prove(int64_t conn, uint64_t n, uint64_t d, uint64_t *cycle, uint8_t (*commitment)[d][32], uint8_t (*salts)[d][32], uint64_t *permutation, uint64_t *pcycle, uint64_t *pindex, uint8_t (*psalts)[32], uint8_t *challenge) {
 
     // send `commitment` to the verifier
-    int64_t err = write(conn, commitment, n * n * 32);
-    if(err < 0) {
+    if(!write_full(conn, commitment, n * d * 32)) {
         perror("commitment write() failed");
-        _exit(1);
+        return 0;
     }
     
     // read `b` from the verifier
     uint8_t b;
-    int64_t nread = read(conn, &b, sizeof(uint8_t));
-    if(nread < 1) {
+    if(!read_full(conn, &b, sizeof(uint8_t))) {
         perror("b read() failed");
+        return 0;
+    }
+    
+    if(b == PROOF_DONE) {
+        printf("verifier ended the proof early\n");
+        _exit(1);
+    }
+    
+    // a resent commitment may only be opened for the challenge it already got,
+    // or the verifier could learn both openings
+    if(*challenge != NO_CHALLENGE && b != *challenge) {
+        printf("verifier changed its challenge\n");
         _exit(1);
     }
+    *challenge = b;
     
     switch(b) {
     
         case 0: {   // decommit the entire permuted adjacency matrix
         
             // send the vertex `permutation` to the verifier
-            err = write(conn, permutation, n * sizeof(uint64_t));
-            if(err < 0) {
+            if(!write_full(conn, permutation, n * sizeof(uint64_t))) {
                 perror("permutation write() failed");
-                _exit(1);
+                return 0;
             }
         
             // send the original `salts` to the verifier
-            err = write(conn, salts, n * n * 32);
-            if(err < 0) {
+            if(!write_full(conn, salts, n * d * 32)) {
                 perror("salts write() failed");
-                _exit(1);
+                return 0;
             }
             break;
         }
         
         case 1: {   // decommit only the hamiltonian cycle
             
-            uint64_t *pcycle = (uint64_t *) commitment[0];
-            uint8_t (*psalts)[32] = commitment[1];
-            
             // permute the hamiltonian cycle
             for(uint64_t i = 0; i < n+1; i++) {
                 pcycle[i] = permutation[cycle[i]];
             }
             
-            // pick out the corresponding salts to the cycle
+            // pick out the corresponding entries to the cycle
             for(uint64_t i = 0; i < n; i++) {
                 uint64_t p = pcycle[i];
                 uint64_t q = pcycle[i+1];
                 
+                for(uint64_t t = 0; t < d; t++) {
+                    if(salts[p][t][ENTRY_BIT] == 1 && entry_col(salts[p][t]) == q) {
+                        pindex[i] = t;
+                        break;
+                    }
+                }
+                
                 for(uint64_t k = 0; k < 32; k++) {
-                    psalts[i][k] = salts[p][q][k];
+                    psalts[i][k] = salts[p][pindex[i]][k];
                 }
             }
             
             // send the permuted cycle to the verifier
-            err = write(conn, pcycle, (n+1) * sizeof(uint64_t));
-            if(err < 0) {
-                perror("salts write() failed");
-                _exit(1);
+            if(!write_full(conn, pcycle, (n+1) * sizeof(uint64_t))) {
+                perror("cycle write() failed");
+                return 0;
+            }
+            
+            // send the position of each edge within its row
+            if(!write_full(conn, pindex, n * sizeof(uint64_t))) {
+                perror("index write() failed");
+                return 0;
             }
             
             // send the corresponding salts to the verifier
-            err = write(conn, psalts, n * 32);
-            if(err < 0) {
+            if(!write_full(conn, psalts, n * 32)) {
                 perror("salts write() failed");
-                _exit(1);
+                return 0;
             }
         
             break;
@@ -129,36 +174,277 @@ void prove(int64_t conn, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, uint8
         }
         
     }
+    
+    return 1;
 }
 
 
-// amplify_prove(conn, nrounds, n, graph, cycle)
-//  perform the repeated zk hamiltonian cycle protocol as the prover
+// handshake(conn, nrounds, session, round, pending, n)
+//  read the verifier's session header and graph, and agree on a hash
+//  returns the malloc'd n x n adjacency matrix, or NULL if the connection dropped
 
 //  `conn`      socket file descriptor
+//  `nrounds`   number of rounds, which the verifier must agree on
+//  `session`   filled with the verifier's session id
+//  `round`     filled with the round the verifier resumes at
+//  `pending`   filled with 1 if that round was already challenged
+//  `n`         filled with the number of vertices
+
+uint8_t *handshake(int64_t conn, uint64_t nrounds, uint64_t *session, uint64_t *round, uint8_t *pending, uint64_t *n) {
+
+    // get the session, its length, and where it left off
+    uint64_t m;
+    if(!read_full(conn, session, sizeof(uint64_t)) || !read_full(conn, &m, sizeof(uint64_t)) || !read_full(conn, round, sizeof(uint64_t)) || !read_full(conn, pending, sizeof(uint8_t))) {
+        perror("session read() failed");
+        return NULL;
+    }
+    if(m != nrounds) {
+        fprintf(stderr, "verifier wants %llu rounds, not %llu\n", m, nrounds);
+        _exit(1);
+    }
+
+    // get n from the verifier
+    if(!read_full(conn, n, sizeof(uint64_t))) {
+        perror("n read() failed");
+        return NULL;
+    }
+    if(*n == 0 || *n > NMAX) {
+        printf("n: %llu out of range\n", *n);
+        _exit(1);
+    }
+    
+    uint8_t (*graph)[*n] = (uint8_t (*)[*n]) calloc(*n * *n, 1);
+    if(graph == NULL) {
+        perror("calloc() failed");
+        _exit(1);
+    }
+    
+    // get adjacency matrix from the verifier
+    if(!read_full(conn, graph, *n * *n)) {
+        perror("graph read() failed");
+        free(graph);
+        return NULL;
+    }
+    
+    // check adjacency matrix validity
+    for(uint64_t i = 0; i < *n; i++) {
+        for(uint64_t j = 0; j < *n; j++) {
+            if(graph[i][j] != 0 && graph[i][j] != 1) {
+                printf("graph[%llu][%llu] = %u\n", i, j, graph[i][j]);
+                _exit(1);
+            }
+        }
+    }
+    
+    // get the proposed digest function, and use our fastest backend for it
+    uint8_t f = HASH_NONE;
+    if(!read_full(conn, &f, sizeof(uint8_t))) {
+        perror("hash read() failed");
+        free(graph);
+        return NULL;
+    }
+    
+    uint8_t hash = hash_fastest(f);
+    uint8_t reply = hash == HASH_NONE ? HASH_NONE : f;
+    if(!write_full(conn, &reply, sizeof(uint8_t))) {
+        perror("hash write() failed");
+        free(graph);
+        return NULL;
+    }
+    if(hash == HASH_NONE) {
+        printf("unsupported hash %u\n", f);
+        _exit(1);
+    }
+    hash_select(hash);
+    
+    return (uint8_t *) graph;
+}
+
+
+// reconnect(listener, nrounds, n, graph, session, round, pending)
+//  wait up to RECONNECT_WAIT seconds for the verifier to reconnect with the same graph
+//  returns the new socket file descriptor, or -1 if it never did
+
+//  `listener`  listening socket file descriptor
+//  `nrounds`   number of rounds
+//  `n`         number of vertices
+//  `graph`     n x n adjacency matrix the session was started with
+//  `session`   filled with the verifier's session id
+//  `round`     filled with the round the verifier resumes at
+//  `pending`   filled with 1 if that round was already challenged
+
+int64_t reconnect(int64_t listener, uint64_t nrounds, uint64_t n, uint8_t (*graph)[n], uint64_t *session, uint64_t *round, uint8_t *pending) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t deadline = now.tv_sec + RECONNECT_WAIT;
+
+    while(1) {
+    
+        // give up once the verifier has had time for all of its retries
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        struct pollfd pfd = {.fd = listener, .events = POLLIN};
+        int64_t ready = now.tv_sec < deadline ? poll(&pfd, 1, (deadline - now.tv_sec) * 1000) : 0;
+        if(ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if(ready < 0) {
+            perror("poll() failed");
+            _exit(1);
+        }
+        if(ready == 0) {
+            fprintf(stderr, "verifier didn't reconnect within %d seconds\n", RECONNECT_WAIT);
+            return -1;
+        }
+        
+        int64_t conn = accept(listener, NULL, NULL);
+        if(conn < 0) {
+            perror("accept() failed");
+            _exit(1);
+        }
+        
+        uint64_t m = 0;
+        uint8_t *input = handshake(conn, nrounds, session, round, pending, &m);
+        if(input == NULL) {
+            close(conn);
+            continue;
+        }
+        
+        // our cycle is only for the original graph
+        if(m != n || memcmp(input, graph, n * n) != 0) {
+            printf("graph changed on reconnect\n");
+            _exit(1);
+        }
+        free(input);
+        
+        return conn;
+    }
+}
+
+
+// amplify_prove(listener, conn, nrounds, n, graph, cycle, session, round, pending)
+//  perform the repeated zk hamiltonian cycle protocol as the prover,
+//  resuming whenever the verifier reconnects after a dropped connection
+//  returns 0 if the verifier dropped and never came back
+
+//  `listener`  listening socket file descriptor
+//  `conn`      socket file descriptor, after handshake()
 //  `nrounds`   number of rounds (soundness is 2^{-nrounds})
 //  `n`         number of vertices
 //  `graph`     n x n adjacency matrix
 //  `cycle`     n+1 item array with the secret hamiltonian cycle
+//  `session`   the verifier's session id, from handshake()
+//  `round`     the round to start at, from handshake()
+//  `pending`   1 if that round was already challenged, from handshake()
 
-void amplify_prove(int64_t conn, uint64_t nrounds, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle) {
+uint8_t amplify_prove(int64_t listener, int64_t conn, uint64_t nrounds, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, uint64_t session, uint64_t round, uint8_t pending) {
     
-    uint64_t sz = n * n * 32;
-    uint8_t (*commitment)[n][32] = (uint8_t (*)[n][32]) malloc(sz);
-    uint8_t (*salts)[n][32] = (uint8_t (*)[n][32]) malloc(sz);
-    uint64_t *permutation = (uint64_t *) calloc(n, sizeof(uint64_t));
+    uint64_t d = max_degree(n, graph);
+    uint64_t sz = n * d * 32;
+    uint64_t *order = (uint64_t *) calloc(d, sizeof(uint64_t));
+    uint64_t *pcycle = (uint64_t *) calloc(n+1, sizeof(uint64_t));
+    uint64_t *pindex = (uint64_t *) calloc(n, sizeof(uint64_t));
+    uint8_t (*psalts)[32] = (uint8_t (*)[32]) malloc(n * 32);
+    
+    // rounds alternate between two slots, since a verifier that drops right
+    // after our answer resumes at the round before the one we're on
+    uint8_t (*commitment[2])[d][32];
+    uint8_t (*salts[2])[d][32];
+    uint64_t *permutation[2];
+    uint64_t slot_session[2];
+    uint64_t slot_round[2];
+    uint8_t slot_b[2];
+    for(uint64_t s = 0; s < 2; s++) {
+        commitment[s] = (uint8_t (*)[d][32]) malloc(sz);
+        salts[s] = (uint8_t (*)[d][32]) malloc(sz);
+        permutation[s] = (uint64_t *) calloc(n, sizeof(uint64_t));
+        slot_session[s] = 0;
+        slot_round[s] = nrounds;
+        slot_b[s] = NO_CHALLENGE;
+        if(commitment[s] == NULL || salts[s] == NULL || permutation[s] == NULL) {
+            perror("malloc() failed");
+            _exit(1);
+        }
+    }
+    if(order == NULL || pcycle == NULL || pindex == NULL || psalts == NULL) {
+        perror("malloc() failed");
+        _exit(1);
+    }
     
     // declare /dev/urandom cache size
-    random_init(n * n * 32);
+    random_init(n * d * 32);
+    
+    // total time spent in commit(), reported at the end
+    double commit_ms = 0;
+    uint64_t ncommits = 0;
+    
+    while(1) {
+    
+        // a challenged round can only be answered from the commitment it was
+        // challenged on; if we don't have it, the verifier counts it as failed
+        uint64_t s = round % 2;
+        uint8_t ack = !pending || (slot_session[s] == session && slot_round[s] == round);
+        uint8_t resume = pending && ack;
+        uint8_t ok = write_full(conn, &ack, sizeof(uint8_t));
+        if(!ack) {
+            round++;
+        }
+        
+        // repeat protocol to improve soundness
+        for(; ok && round < nrounds; round++) {
+            s = round % 2;
+            
+            // every new round gets a fresh commitment
+            if(!resume) {
+                struct timespec start, end;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                commit(n, d, graph, commitment[s], salts[s], permutation[s], order);
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                commit_ms += (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+                ncommits++;
+                slot_session[s] = session;
+                slot_round[s] = round;
+                slot_b[s] = NO_CHALLENGE;
+            }
+            resume = 0;
+            
+            ok = prove(conn, n, d, cycle, commitment[s], salts[s], permutation[s], pcycle, pindex, psalts, &slot_b[s]);
+            if(!ok) {
+                break;
+            }
+        }
+        
+        // wait for the verifier to confirm it got the last round
+        uint8_t done;
+        if(ok && read_full(conn, &done, sizeof(uint8_t))) {
+            if(done != PROOF_DONE) {
+                printf("verifier sent %u after the last round\n", done);
+                _exit(1);
+            }
+            close(conn);
+            break;
+        }
+        
+        close(conn);
+        conn = reconnect(listener, nrounds, n, graph, &session, &round, &pending);
+        if(conn < 0) {
+            break;
+        }
+    }
+    
+    verbose_printf("commit: %.3f ms over %llu rounds\n", commit_ms, ncommits);
     
-    // repeat protocol to improve soundness
-    for(uint64_t i = 0; i < nrounds; i++) {
-        prove(conn, n, graph, cycle, commitment, salts, permutation);
+    for(uint64_t s = 0; s < 2; s++) {
+        free(commitment[s]);
+        free(salts[s]);
+        free(permutation[s]);
     }
+    free(order);
+    free(pcycle);
+    free(pindex);
+    free(psalts);
     
-    free(commitment);
-    free(salts);
-    free(permutation);
+    return conn >= 0;
 }
 
 
@@ -173,6 +459,18 @@ int main(int argc, char **argv) {
     else {
         nrounds = strtol(argv[1], NULL, 10);
     }
+    
+    char *path = UDS_NAME;
+    if(argc >= 3) {
+        path = argv[2];
+    }
+    
+    struct sockaddr_un server;
+    memset(&server, 0, sizeof(struct sockaddr_un));
+    if(strlen(path) >= sizeof(server.sun_path)) {
+        printf("UDS path too long: %s\n", path);
+        _exit(1);
+    }
 
     // ------ open UDS for verifier --------------------------------------------
 
@@ -182,10 +480,9 @@ int main(int argc, char **argv) {
         _exit(1);
     }
     
-    struct sockaddr_un server;
     server.sun_family = AF_UNIX;
-    unlink(UDS_NAME);
-    strncpy(server.sun_path, UDS_NAME, 100);
+    unlink(path);
+    strcpy(server.sun_path, path);
     
     int64_t err = bind(fd, (struct sockaddr *) &server, sizeof(struct sockaddr_un));
     if(err < 0) {
@@ -199,40 +496,28 @@ int main(int argc, char **argv) {
         _exit(1);
     }
     
-    int64_t conn = accept(fd, NULL, NULL);
-    if(conn < 0) {
-        perror("accept() failed");
-        _exit(1);
-    }
+    // a dropped connection should be resumed, not kill the prover
+    signal(SIGPIPE, SIG_IGN);
     
     // ------ receive graph from verifier --------------------------------------
     
-    // get n from the verifier
-    uint64_t n = 0;
-    uint64_t nread = read(conn, &n, sizeof(uint64_t));
-    if(nread < sizeof(uint64_t)) {
-        perror("n read() failed");
-        _exit(1);
-    }
-    
-    uint8_t (*graph)[n] = (uint8_t (*)[n]) calloc(n * n, 1);
-    
-    // get adjacency matrix from the verifier
-    nread = read(conn, graph, n * n);
-    if(nread < n * n) {
-        perror("graph read() failed");
-        _exit(1);
-    }
-    
-    // check adjacency matrix validity
-    for(uint64_t i = 0; i < n; i++) {
-        for(uint64_t j = 0; j < n; j++) {
-            if(graph[i][j] != 0 && graph[i][j] != 1) {
-                printf("graph[%llu][%llu] = %u\n", i, j, graph[i][j]);
-                _exit(1);
-            }
+    int64_t conn;
+    uint64_t session, round, n;
+    uint8_t pending;
+    uint8_t *received;
+    do {
+        conn = accept(fd, NULL, NULL);
+        if(conn < 0) {
+            perror("accept() failed");
+            _exit(1);
         }
-    }
+        received = handshake(conn, nrounds, &session, &round, &pending, &n);
+        if(received == NULL) {
+            close(conn);
+        }
+    } while(received == NULL);
+    
+    uint8_t (*graph)[n] = (uint8_t (*)[n]) received;
     
     // ------ read cycle from stdin --------------------------------------------
     
@@ -251,21 +536,13 @@ int main(int argc, char **argv) {
     
     uint64_t *cycle = calloc(n+1, sizeof(uint64_t));
     
-    uint64_t logn = sizeof(n) * 8 - __builtin_clzl(n);  // find max input length
-    uint64_t sz = n * (logn/3 + 1) + 1;
-    char *iptr = malloc(sz);
-    char *optr = iptr;
-    
     // read the secret hamiltonian cycle
-    ret = fgets(iptr, sz, stdin);
-    if(ret == NULL) {
-        perror("fgets() failed");
-        _exit(1);
-    }
     for(uint64_t i = 0; i < n+1; i++) {
-        cycle[i] = strtol(iptr, &iptr, 10);
+        if(scanf("%" SCNu64, &cycle[i]) < 1 || cycle[i] >= n) {
+            printf("invalid cycle: entry %llu\n", i);
+            _exit(1);
+        }
     }
-    free(optr);
     
     // check cycle validity
     for(uint64_t i = 0; i < n; i++) {
@@ -277,10 +554,10 @@ int main(int argc, char **argv) {
     
     // ------ enter proof protocol ---------------------------------------------
     
-    amplify_prove(conn, nrounds, n, graph, cycle);
+    uint8_t finished = amplify_prove(fd, conn, nrounds, n, graph, cycle, session, round, pending);
     
     free(graph);
     free(cycle);
 
-    return 0;
+    return finished ? 0 : 1;
 }
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Garrett Tanzer
+# zk scaling sweep
+
+# `sweep.sh degree nrounds n...` generates an instance with average out-degree
+# `degree` for each n, proves it once, and prints one line per n: the time to
+# generate it, the prover's total commit() time, and the verifier's latency
+
+if [ $# -lt 3 ]; then
+    echo "usage: sweep.sh degree nrounds n..."
+    exit 1
+fi
+
+degree=$1
+nrounds=$2
+shift 2
+
+cd "$(dirname "$0")" || exit 1
+
+# time uninstrumented builds, like bench
+make -s gen prover-fast verifier-fast || exit 1
+
+dir=$(mktemp -d) || exit 1
+prover=
+trap 'if [ -n "$prover" ]; then kill $prover 2> /dev/null; fi; rm -rf "$dir"' EXIT
+
+printf "%10s %8s %12s %12s %12s %12s %8s\n" n degree density gen_ms commit_ms verify_ms result
+
+for n in "$@"; do
+    density=$(awk "BEGIN { p = $degree / $n; print (p < 1 ? p : 1) }")
+
+    start=$(date +%s%N)
+    ./gen -p -s "$n" "$n" "$density" "$dir/graph.txt" "$dir/cycle.txt" > /dev/null || exit 1
+    gen_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+
+    ./prover-fast "$nrounds" "$dir/uds" < "$dir/cycle.txt" > "$dir/prover.log" 2>&1 &
+    prover=$!
+    while [ ! -S "$dir/uds" ]; do
+        kill -0 $prover 2> /dev/null || { cat "$dir/prover.log"; exit 1; }
+        sleep 0.1
+    done
+
+    # batch mode with one job reports the latency without per-round output
+    echo "$dir/graph.txt $dir/uds" | ./verifier-fast -j 1 "$nrounds" > "$dir/verifier.log"
+    read job graph uds result verify_ms < "$dir/verifier.log"
+
+    # the prover exits once the proof is done, or once a dropped verifier fails
+    # to come back, but a verifier that never reached it leaves it in accept()
+    if [ "$result" != 0 ] && [ "$result" != 1 ]; then
+        kill $prover 2> /dev/null
+    fi
+    wait $prover 2> /dev/null
+    prover=
+    rm -f "$dir/uds"
+
+    commit_ms=$(awk '/^commit:/ { print $2 }' "$dir/prover.log")
+
+    printf "%10s %8s %12s %12s %12s %12s %8s\n" "$n" "$degree" "$density" "$gen_ms" "${commit_ms:--}" "${verify_ms:--}" "${result:-error}"
+done
@@ -3,120 +3,309 @@
 
 #include "zklib.h"
 
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+// verify() result when the prover breaks the protocol
+#define ABORT 2
+// verify() result when the connection drops, so the round can be resumed
+#define DROPPED 3
+
+
+// checkpoint
+//  the verifier's round state, which survives a dropped connection
+//  (and a restarted verifier, when it is saved to a file)
+
+struct checkpoint {
+    uint64_t session;       // random id naming this proof to the prover
+    uint64_t n;             // number of vertices, to catch a mismatched resume
+    uint64_t nrounds;       // number of rounds, likewise
+    uint8_t graph[32];      // SHA256 of the adjacency matrix, likewise
+    uint8_t f;              // digest function the commitments are checked with
+    uint64_t round;         // next round to run
+    uint8_t accept;         // AND of the completed rounds' results
+    uint8_t pending;        // 1 if `round` has been challenged but not checked
+    uint8_t b;              // the challenge sent for `round`
+    uint8_t digest[32];     // SHA256 of the commitment for `round`
+};
+
+
+// checkpoint_save(path, cp)
+//  atomically replace the checkpoint file at `path` (if any) with `cp`
+//  returns 0 on failure
+
+uint8_t checkpoint_save(char *path, struct checkpoint *cp) {
+    if(path == NULL) {
+        return 1;
+    }
+    
+    char tmp[1UL << 12];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    
+    FILE *out = fopen(tmp, "wb");
+    if(out == NULL) {
+        perror("checkpoint fopen() failed");
+        return 0;
+    }
+    uint64_t nwritten = fwrite(cp, sizeof(struct checkpoint), 1, out);
+    if(fclose(out) != 0 || nwritten < 1 || rename(tmp, path) < 0) {
+        perror("checkpoint write failed");
+        return 0;
+    }
+    
+    return 1;
+}
+
+
+// checkpoint_load(path, cp, n, graph, nrounds, f)
+//  fill `cp` from the checkpoint file at `path`, or start a new one if there is none
+//  returns 0 if the file belongs to a different proof
+
+//  `path`      checkpoint file, or NULL
+//  `cp`        checkpoint to fill
+//  `n`         number of vertices
+//  `graph`     n x n adjacency matrix
+//  `nrounds`   number of rounds
+//  `f`         digest function (see hash_function())
+
+uint8_t checkpoint_load(char *path, struct checkpoint *cp, uint64_t n, uint8_t (*graph)[n], uint64_t nrounds, uint8_t f) {
+    memset(cp, 0, sizeof(struct checkpoint));
+    cp->n = n;
+    cp->nrounds = nrounds;
+    (void) SHA256((uint8_t *) graph, n * n, cp->graph);
+    cp->f = f;
+    cp->accept = 1;
+    
+    // a resumed proof must be of the same graph, or the rounds already
+    // accepted would count towards a graph they never checked
+    uint8_t expected[32];
+    memcpy(expected, cp->graph, 32);
+    
+    FILE *in = path == NULL ? NULL : fopen(path, "rb");
+    if(in == NULL) {
+        return 1;
+    }
+    uint64_t nread = fread(cp, sizeof(struct checkpoint), 1, in);
+    fclose(in);
+    
+    if(nread < 1 || cp->n != n || cp->nrounds != nrounds || memcmp(cp->graph, expected, 32) != 0 || cp->f != f) {
+        fprintf(stderr, "checkpoint %s is for a different proof\n", path);
+        return 0;
+    }
+    
+    return 1;
+}
+
 
-// decommit_graph(n, graph, commitment, salts, permutation)
+// decommit_graph(n, d, graph, degree, commitment, salts, permutation, inverse, seen)
 //  verify for b = 0 that the committed graph is a permutation of `graph`
+//  every entry is checked branch-free, and the first failure is reported at the end
 
 //  `n`             number of vertices
+//  `d`             row width (max out-degree of `graph`)
 //  `graph`         n x n adjacency matrix
-//  `commitment`    n x n matrix with 256-bit commitment hashes
-//  `salts`         n x n matrix to store the inversion of `commitments`
+//  `degree`        n item array with the out-degree of each vertex in `graph`
+//  `commitment`    n x d matrix with 256-bit commitment hashes
+//  `salts`         n x d matrix to store the inversion of `commitments`
 //  `permutation`   n item array with the prover's vertex permutation
+//  `inverse`       n item array with the inverse of `permutation`
+//  `seen`          n item array used to detect repeated columns
 
-uint8_t decommit_graph(uint64_t n, uint8_t (*graph)[n], uint8_t (*commitment)[n][32], uint8_t (*salts)[n][32], uint64_t *permutation) {
+uint8_t decommit_graph(uint64_t n, uint64_t d, uint8_t (*graph)[n], uint64_t *degree, uint8_t (*commitment)[d][32], uint8_t (*salts)[d][32], uint64_t *permutation, uint64_t *inverse, uint64_t *seen) {
 
     uint8_t cur[32];
+    
+    // first failing cell (p * d + t) or row p, or `none` / n if there is none
+    uint64_t none = n * d;
+    uint64_t bad_hash = none;
+    uint64_t bad_salt = none;
+    uint64_t bad_row = n;
+    
+    memset(seen, 0, n * sizeof(uint64_t));
 
     for(uint64_t i = 0; i < n; i++) {
-        for(uint64_t j = 0; j < n; j++) {
-            uint64_t p = permutation[i];
-            uint64_t q = permutation[j];
+        uint64_t p = permutation[i];
+        uint64_t count = 0;
         
-            // check that the pre-commitment graph is a permutation of `graph`
-            if(salts[p][q][31] != graph[i][j]) {
-                verbose_printf("invalid salt\n");
-                return 0;
-            }
+        for(uint64_t t = 0; t < d; t++) {
+            uint8_t *entry = salts[p][t];
+            uint64_t cell = p * d + t;
+        
+            // commit the permuted row and check that it equals what we got before
+            hash32(entry, cur);
+            uint64_t hash_ok = digest_diff(cur, commitment[p][t]) == 0;
             
-            // commit the permuted graph and check that it equals what we got before
-            (void) SHA256(&salts[p][q][0], 32, cur);
-            for(uint64_t k = 0; k < 32; k++) {
-                if(cur[k] != commitment[p][q][k]) {
-                    verbose_printf("salt produces incorrect hash\n");
-                    return 0;
-                }
-            }
+            // check that each committed edge is a distinct permuted edge of `graph`,
+            // clamping the column so the lookups stay in bounds even when it's invalid
+            uint64_t bit = entry[ENTRY_BIT];
+            uint64_t live = bit == 1;
+            uint64_t q = entry_col(entry);
+            uint64_t in = q < n;
+            q *= in;
+            uint64_t edge = in & (seen[q] != p+1) & (graph[i][inverse[q]] == 1);
+            uint64_t salt_ok = (bit <= 1) & ((live ^ 1) | edge);
+            seen[q] = ct_select(live, p+1, seen[q]);
+            count += live;
+            
+            bad_hash = ct_select((hash_ok ^ 1) & (bad_hash == none), cell, bad_hash);
+            bad_salt = ct_select((salt_ok ^ 1) & (bad_salt == none), cell, bad_salt);
         }
+        
+        // check that no edge of `graph` is missing from the row
+        bad_row = ct_select((count != degree[i]) & (bad_row == n), p, bad_row);
+    }
+    
+    if(bad_hash != none) {
+        verbose_printf("salt (%llu, %llu) produces incorrect hash\n", bad_hash / d, bad_hash % d);
+        return 0;
+    }
+    if(bad_salt != none) {
+        verbose_printf("invalid salt (%llu, %llu)\n", bad_salt / d, bad_salt % d);
+        return 0;
+    }
+    if(bad_row != n) {
+        verbose_printf("row %llu is missing edges\n", bad_row);
+        return 0;
     }
     
     return 1;
 }
 
-// decommit_cycle(n, commitment, salts, cycle)
+// decommit_cycle(n, d, commitment, salts, cycle, index)
 //  verify for b = 1 that there is a committed hamiltonian cycle
+//  every edge is checked branch-free, and the first failure is reported at the end
 
 //  `n`             number of vertices
-//  `commitment`    n x n matrix with 256-bit commitment hashes
+//  `d`             row width (max out-degree of the graph)
+//  `commitment`    n x d matrix with 256-bit commitment hashes
 //  `salts`         n item matrix with the salts corresponding to the edges in `cycle`
 //  `cycle`         n+1 item array with the prover's permuted hamiltonian cycle
+//  `index`         n item array with the position of each edge of `cycle` in its row
 
-uint8_t decommit_cycle(uint64_t n, uint8_t (*commitment)[n][32], uint8_t (*salts)[32], uint64_t *cycle) {
+uint8_t decommit_cycle(uint64_t n, uint64_t d, uint8_t (*commitment)[d][32], uint8_t (*salts)[32], uint64_t *cycle, uint64_t *index) {
 
     uint8_t cur[32];
+    
+    // first failing edge of the cycle, or n if there is none
+    uint64_t bad_hash = n;
+    uint64_t bad_salt = n;
 
     for(uint64_t i = 0; i < n; i++) {
         uint64_t p = cycle[i];
         uint64_t q = cycle[i+1];
+        
+        // clamp the entry position so the lookup stays in bounds even when it's invalid
+        uint64_t in = index[i] < d;
+        uint64_t t = index[i] * in;
     
         // check that each edge in the cycle is a real pre-commitment edge
-        if(salts[i][31] != 1) {
-            verbose_printf("invalid salt\n");
-            return 0;
-        }
+        uint64_t salt_ok = in & (salts[i][ENTRY_BIT] == 1) & (entry_col(salts[i]) == q);
     
         // commit the permuted cycle and check that it equals what we got before
-        (void) SHA256(salts[i], 32, cur);
-        for(uint64_t k = 0; k < 32; k++) {
-            if(cur[k] != commitment[p][q][k]) {
-                verbose_printf("salt produces incorrect hash\n");
-                return 0;
-            }
-        }
+        hash32(salts[i], cur);
+        uint64_t hash_ok = digest_diff(cur, commitment[p][t]) == 0;
+        
+        bad_hash = ct_select((hash_ok ^ 1) & (bad_hash == n), i, bad_hash);
+        bad_salt = ct_select((salt_ok ^ 1) & (bad_salt == n), i, bad_salt);
+    }
+    
+    if(bad_salt != n) {
+        verbose_printf("invalid salt for edge %llu\n", bad_salt);
+        return 0;
+    }
+    if(bad_hash != n) {
+        verbose_printf("salt for edge %llu produces incorrect hash\n", bad_hash);
+        return 0;
     }
     
     return 1;
 }
 
 
-// verify(conn, n, graph, cycle, commitment, salts, permutation, visited)
+// verify(conn, n, d, graph, degree, cycle, commitment, salts, permutation, index, visited, cp, cpath)
 //  perform a single round of the zk hamiltonian cycle protocol as the verifier
+//  returns ABORT if the prover broke the protocol, or DROPPED if the connection did
 
 //  `conn`          socket file descriptor
 //  `n`             number of vertices
+//  `d`             row width (max out-degree of `graph`)
 //  `graph`         n x n adjacency matrix
+//  `degree`        n item array with the out-degree of each vertex in `graph`
 //  `cycle`         n+1 item array to store the prover's permuted hamiltonian cycle
-//  `commitment`    n x n matrix to store 256-bit commitment hashes
-//  `salts`         n x n matrix to store the inversion of `commitments`
+//  `commitment`    n x d matrix to store 256-bit commitment hashes
+//  `salts`         n x d matrix to store the inversion of `commitments`
 //  `permutation`   n item array to store the prover's vertex permutation
+//  `index`         n item array used for the inverse permutation or cycle entry positions
 //  `visited`       n item array used to verify permutations and cycles
+//  `cp`            checkpoint, which says whether this round was already challenged
+//  `cpath`         path to save `cp` to, or NULL
+
+uint8_t verify(int64_t conn, uint64_t n, uint64_t d, uint8_t (*graph)[n], uint64_t *degree, uint64_t *cycle, uint8_t (*commitment)[d][32], uint8_t (*salts)[d][32], uint64_t *permutation, uint64_t *index, uint64_t *visited, struct checkpoint *cp, char *cpath) {
 
-uint8_t verify(int64_t conn, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, uint8_t (*commitment)[n][32], uint8_t (*salts)[n][32], uint64_t *permutation, uint8_t *visited) {
+    uint64_t sz = n * d * 32;
 
-    uint64_t sz = n * n * 32;
+    // a commitment resent for a round challenged in this process is read into
+    // `salts` (unused until the opening), so that `commitment` still holds the
+    // original to compare against
+    uint8_t in_memory = cp->pending && cpath == NULL;
+    uint8_t (*received)[d][32] = in_memory ? salts : commitment;
 
     // read `commitment` from the prover
-    int64_t nread = read(conn, commitment, sz);
-    if(nread < sz) {
+    if(!read_full(conn, received, sz)) {
         perror("commitment read() failed");
-        _exit(1);
+        return DROPPED;
     }
     verbose_printf("commitment:\n");
     for(uint64_t i = 0; i < n; i++) {
-        for(uint64_t j = 0; j < n; j++) {
+        for(uint64_t j = 0; j < d; j++) {
             for(uint64_t k = 0; k < 32; k++) {
-                verbose_printf("%02x", commitment[i][j][k]);
+                verbose_printf("%02x", received[i][j][k]);
             }
             verbose_printf("\n");
         }
         verbose_printf("\n");
     }
     
-    // send a random b to the prover
-    uint8_t b = random_flip();
-    int64_t err = write(conn, &b, sizeof(uint8_t));
-    if(err < 0) {
+    uint8_t b;
+    if(cp->pending) {
+    
+        // a resumed round must be the commitment we already challenged; only a
+        // checkpoint file needs its digest, since it outlives `commitment`
+        uint8_t differs;
+        if(in_memory) {
+            differs = memcmp(received, commitment, sz) != 0;
+        }
+        else {
+            uint8_t cur[32];
+            (void) SHA256((uint8_t *) commitment, sz, cur);
+            differs = digest_diff(cur, cp->digest) != 0;
+        }
+        if(differs) {
+            fprintf(stderr, "resumed commitment differs\n");
+            return ABORT;
+        }
+        b = cp->b;
+    }
+    else {
+    
+        // record the challenge before sending it, so that dropping the
+        // connection can't get the prover a different one
+        b = random_flip();
+        if(cpath != NULL) {
+            (void) SHA256((uint8_t *) commitment, sz, cp->digest);
+        }
+        cp->b = b;
+        cp->pending = 1;
+        if(!checkpoint_save(cpath, cp)) {
+            return ABORT;
+        }
+    }
+    
+    // send b to the prover
+    if(!write_full(conn, &b, sizeof(uint8_t))) {
         perror("b write() failed");
-        _exit(1);
+        return DROPPED;
     }
     verbose_printf("b = %u\n\n", b);
     
@@ -127,36 +316,35 @@ uint8_t verify(int64_t conn, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, u
             verbose_printf("decommitting adjacency matrix\n\n");
         
             // read the vertex `permutation` from the prover
-            nread = read(conn, permutation, n * sizeof(uint64_t));
-            if(nread < n) {
+            if(!read_full(conn, permutation, n * sizeof(uint64_t))) {
                 perror("permutation read() failed");
-                _exit(1);
+                return DROPPED;
             }
             verbose_printf("permutation:\n");
             
-            // check that `permutation` is indeed a permutation
-            memset(visited, 0, n);
+            // check that `permutation` is indeed a permutation, and invert it
+            memset(visited, 0, n * sizeof(uint64_t));
             for(uint64_t i = 0; i < n; i++) {
                 verbose_printf("%llu: %llu\n", i, permutation[i]);
                 if(permutation[i] < n && visited[permutation[i]] == 0) {
                     visited[permutation[i]] = 1;
+                    index[permutation[i]] = i;
                 }
                 else {
-                    printf("invalid permutation\n");
-                    _exit(1);
+                    fprintf(stderr, "invalid permutation\n");
+                    return ABORT;
                 }
             }
             verbose_printf("\n");
             
             // read the `salts` from the prover
-            nread = read(conn, salts, sz);
-            if(nread < sz) {
+            if(!read_full(conn, salts, sz)) {
                 perror("salts read() failed");
-                _exit(1);
+                return DROPPED;
             }
             verbose_printf("salts:\n");
             for(uint64_t i = 0; i < n; i++) {
-                for(uint64_t j = 0; j < n; j++) {
+                for(uint64_t j = 0; j < d; j++) {
                     for(uint64_t k = 0; k < 32; k++) {
                         verbose_printf("%02x", salts[i][j][k]);
                     }
@@ -166,7 +354,7 @@ uint8_t verify(int64_t conn, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, u
             }
             
             // check that the prover is honest
-            return decommit_graph(n, graph, commitment, salts, permutation);
+            return decommit_graph(n, d, graph, degree, commitment, salts, permutation, index, visited);
             
         }
         
@@ -175,39 +363,44 @@ uint8_t verify(int64_t conn, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, u
             verbose_printf("decommitting hamiltonian cycle\n\n");
         
             // read the hamiltonian `cycle` from the prover
-            nread = read(conn, cycle, (n+1) * sizeof(uint64_t));
-            if(nread < n+1) {
+            if(!read_full(conn, cycle, (n+1) * sizeof(uint64_t))) {
                 perror("cycle read() failed");
-                _exit(1);
+                return DROPPED;
             }
             verbose_printf("cycle:\n");
             
             // check that `cycle` is indeed a cycle
-            memset(visited, 0, n);
+            memset(visited, 0, n * sizeof(uint64_t));
             for(uint64_t i = 0; i < n; i++) {
                 verbose_printf("%llu -> ", cycle[i]);
                 if(cycle[i] < n && visited[cycle[i]] == 0) {
                     visited[cycle[i]] = 1;
                 }
                 else {
-                    printf("invalid cycle\n");
-                    _exit(1);
+                    fprintf(stderr, "invalid cycle\n");
+                    return ABORT;
                 }
             }
             verbose_printf("%llu\n\n", cycle[0]);
             if(cycle[n] >= n || cycle[0] != cycle[n]) {
-                printf("incomplete cycle\n");
-                _exit(1);
+                fprintf(stderr, "incomplete cycle\n");
+                return ABORT;
+            }
+            
+            // read the position of each cycle edge within its row
+            if(!read_full(conn, index, n * sizeof(uint64_t))) {
+                perror("index read() failed");
+                return DROPPED;
             }
             
             // read the cycle's `salts` from the prover
-            nread = read(conn, salts[0], n * 32);
-            if(nread < n) {
+            if(!read_full(conn, salts[0], n * 32)) {
                 perror("cycle salts read() failed");
-                _exit(1);
+                return DROPPED;
             }
             verbose_printf("salts:\n");
             for(uint64_t j = 0; j < n; j++) {
+                verbose_printf("%llu: ", index[j]);
                 for(uint64_t k = 0; k < 32; k++) {
                     verbose_printf("%02x", salts[0][j][k]);
                 }
@@ -215,13 +408,13 @@ uint8_t verify(int64_t conn, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, u
             }
             
             // check that the prover is honest
-            return decommit_cycle(n, commitment, salts[0], cycle);
+            return decommit_cycle(n, d, commitment, salts[0], cycle, index);
             
         }
         
         default: {
-            printf("b = %u\n", b);
-            _exit(1);
+            fprintf(stderr, "b = %u\n", b);
+            return ABORT;
         }
         
     }
@@ -230,129 +423,507 @@ uint8_t verify(int64_t conn, uint64_t n, uint8_t (*graph)[n], uint64_t *cycle, u
 }
 
 
-// amplify_verify(conn, nrounds, n, graph)
-//  perform the repeated zk hamiltonian cycle protocol as the verifier
+// connect_prover(path, n, graph, f, cp, ack)
+//  connect to the prover's UDS at `path`, send it the session, round count, resume
+//  point, and graph, and agree on a hash
+//  returns the socket file descriptor, or -1 on failure
+
+//  `path`      UDS path the prover is listening on
+//  `n`         number of vertices
+//  `graph`     n x n adjacency matrix
+//  `f`         digest function to propose (see hash_function())
+//  `cp`        checkpoint naming the session and the round to resume at
+//  `ack`       filled with 0 if the prover can't resume a pending round, 1 otherwise
+
+int64_t connect_prover(char *path, uint64_t n, uint8_t (*graph)[n], uint8_t f, struct checkpoint *cp, uint8_t *ack) {
+
+    int64_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) {
+		perror("socket() failed");
+		return -1;
+	}
+	
+	struct sockaddr_un server;
+	memset(&server, 0, sizeof(struct sockaddr_un));
+	if(strlen(path) >= sizeof(server.sun_path)) {
+		fprintf(stderr, "UDS path too long: %s\n", path);
+		close(fd);
+		return -1;
+	}
+	server.sun_family = AF_UNIX;
+	strcpy(server.sun_path, path);
+	
+	int64_t err = connect(fd, (struct sockaddr *) &server, sizeof(struct sockaddr_un));
+	if(err < 0) {
+		perror("connect() failed");
+		close(fd);
+		return -1;
+	}
+	
+	// say which session this is and where it left off
+	if(!write_full(fd, &cp->session, sizeof(uint64_t)) || !write_full(fd, &cp->nrounds, sizeof(uint64_t)) || !write_full(fd, &cp->round, sizeof(uint64_t)) || !write_full(fd, &cp->pending, sizeof(uint8_t))) {
+		perror("session write() failed");
+		close(fd);
+		return -1;
+	}
+    
+	if(!write_full(fd, &n, sizeof(uint64_t))) {
+		perror("n write() failed");
+		close(fd);
+		return -1;
+	}
+    
+	if(!write_full(fd, graph, n * n)) {
+		perror("graph write() failed");
+		close(fd);
+		return -1;
+	}
+	
+	// propose `f`, which the prover echoes back if it can compute it
+	if(!write_full(fd, &f, sizeof(uint8_t))) {
+		perror("hash write() failed");
+		close(fd);
+		return -1;
+	}
+	
+	uint8_t reply = HASH_NONE;
+	if(!read_full(fd, &reply, sizeof(uint8_t))) {
+		perror("hash read() failed (does the prover use the same nrounds?)");
+		close(fd);
+		return -1;
+	}
+	if(reply != f) {
+		fprintf(stderr, "prover rejected hash %s\n", hash_names[f]);
+		close(fd);
+		return -1;
+	}
+	
+	if(!read_full(fd, ack, sizeof(uint8_t))) {
+		perror("ack read() failed");
+		close(fd);
+		return -1;
+	}
+	
+	return fd;
+}
+
+
+// amplify_verify(path, nrounds, n, graph, f, cp, cpath)
+//  perform the repeated zk hamiltonian cycle protocol as the verifier,
+//  reconnecting and resuming from `cp` whenever the connection drops
+//  returns ABORT if the prover broke the protocol or could not be reached
 
-//  `conn`      socket file descriptor
+//  `path`      UDS path the prover is listening on
 //  `nrounds`   number of rounds (soundness is 2^{-nrounds})
 //  `n`         number of vertices
 //  `graph`     n x n adjacency matrix
+//  `f`         digest function to propose (see hash_function())
+//  `cp`        checkpoint to resume from and keep up to date
+//  `cpath`     path to save `cp` to after every change, or NULL
 
-uint8_t amplify_verify(int64_t conn, uint64_t nrounds, uint64_t n, uint8_t (*graph)[n]) {
+uint8_t amplify_verify(char *path, uint64_t nrounds, uint64_t n, uint8_t (*graph)[n], uint8_t f, struct checkpoint *cp, char *cpath) {
     
-    uint64_t sz = n * n * 32;
+    uint64_t d = max_degree(n, graph);
+    uint64_t sz = n * d * 32;
+    uint64_t *degree = calloc(n, sizeof(uint64_t));
     uint64_t *cycle = calloc(n+1, sizeof(uint64_t));
-    uint8_t (*commitment)[n][32] = (uint8_t (*)[n][32]) malloc(sz);
-    uint8_t (*salts)[n][32] = (uint8_t (*)[n][32]) malloc(sz);
+    uint8_t (*commitment)[d][32] = (uint8_t (*)[d][32]) malloc(sz);
+    uint8_t (*salts)[d][32] = (uint8_t (*)[d][32]) malloc(sz);
     uint64_t *permutation = (uint64_t *) calloc(n, sizeof(uint64_t));
-    uint8_t *visited = (uint8_t *) malloc(n);
+    uint64_t *index = (uint64_t *) calloc(n, sizeof(uint64_t));
+    uint64_t *visited = (uint64_t *) calloc(n, sizeof(uint64_t));
+    if(degree == NULL || cycle == NULL || commitment == NULL || salts == NULL || permutation == NULL || index == NULL || visited == NULL) {
+        perror("malloc() failed");
+        free(degree);
+        free(cycle);
+        free(commitment);
+        free(salts);
+        free(permutation);
+        free(index);
+        free(visited);
+        return ABORT;
+    }
+    
+    // count each vertex's edges once, rather than every b = 0 round
+    for(uint64_t i = 0; i < n; i++) {
+        for(uint64_t j = 0; j < n; j++) {
+            degree[i] += graph[i][j];
+        }
+    }
 
-    // declare /dev/urandom cache size
-    random_init(nrounds);
+    // declare /dev/urandom cache size, with room for the session id
+    random_init(nrounds + sizeof(uint64_t));
+    
+    // name a new session
+    while(cp->session == 0) {
+        random_fill(sizeof(uint64_t), (uint8_t *) &cp->session);
+    }
+    uint8_t resumed = cp->round > 0 || cp->pending;
+    
+    uint8_t accept = ABORT;
+    uint64_t tries = 0;
+    while(tries < RECONNECT_TRIES) {
+        
+        uint8_t ack = 0;
+        int64_t conn = connect_prover(path, n, graph, f, cp, &ack);
+        if(conn < 0) {
+        
+            // there's nothing to resume if the prover was never reached
+            if(!resumed) {
+                break;
+            }
+            tries++;
+            sleep(RECONNECT_DELAY);
+            continue;
+        }
+        resumed = 1;
+        
+        // the prover lost the challenged round, so it can never be answered
+        if(cp->pending && !ack) {
+            verbose_printf("prover can't resume round %llu\n\n", cp->round);
+            cp->accept = 0;
+            cp->pending = 0;
+            cp->round++;
+        }
 
-    // repeat protocol to improve soundness
-    uint8_t accept = 1;
-    for(uint64_t i = 0; i < nrounds; i++) {
-        verbose_printf("------ verifying round %llu ------\n\n", i);
-        accept &= verify(conn, n, graph, cycle, commitment, salts, permutation, visited);
-        verbose_printf("\n");
+        // repeat protocol to improve soundness
+        uint8_t ret = 1;
+        while(cp->round < nrounds) {
+            verbose_printf("------ verifying round %llu ------\n\n", cp->round);
+            ret = verify(conn, n, d, graph, degree, cycle, commitment, salts, permutation, index, visited, cp, cpath);
+            verbose_printf("\n");
+            
+            if(ret == ABORT || ret == DROPPED) {
+                break;
+            }
+            
+            cp->accept &= ret;
+            cp->pending = 0;
+            cp->round++;
+            tries = 0;
+            if(!checkpoint_save(cpath, cp)) {
+                ret = ABORT;
+                break;
+            }
+        }
+        
+        // tell the prover it's done, which can drop too
+        if(ret != ABORT && ret != DROPPED) {
+            uint8_t done = PROOF_DONE;
+            ret = write_full(conn, &done, sizeof(uint8_t)) ? 1 : DROPPED;
+        }
+        close(conn);
+        
+        if(ret == ABORT) {
+            break;
+        }
+        if(ret != DROPPED) {
+            accept = cp->accept;
+            break;
+        }
+        
+        verbose_printf("connection dropped, resuming at round %llu\n\n", cp->round);
+        tries++;
+        sleep(RECONNECT_DELAY);
     }
     
+    free(degree);
     free(cycle);
     free(commitment);
     free(salts);
     free(permutation);
+    free(index);
+    free(visited);
     
     return accept;
 }
 
 
-int main(int argc, char **argv) {
+// read_graph(in, n)
+//  parse a graph in the format described in README.md
+//  returns a malloc'd n x n adjacency matrix, or NULL if the input is invalid
 
-    // ------ command line arguments -------------------------------------------
-    
-    uint64_t nrounds;
-    if(argc < 2) {
-        nrounds = NROUNDS_DEFAULT;
-    }
-    else {
-        nrounds = strtol(argv[1], NULL, 10);
-    }
+//  `in`        input stream
+//  `n`         filled with the number of vertices
+
+uint8_t *read_graph(FILE *in, uint64_t *n) {
 
-    // ------ read graph from stdin --------------------------------------------
-    
     // read n
     char input[1UL << 6];
-    char *ret = fgets(input, sizeof(input), stdin);
+    char *ret = fgets(input, sizeof(input), in);
     if(ret == NULL) {
         perror("fgets() failed");
-        _exit(1);
+        return NULL;
+    }
+    char *end;
+    *n = strtoull(input, &end, 10);
+    if(end == input || *n == 0 || *n > NMAX) {
+        fprintf(stderr, "n must be in [1, %llu]\n", NMAX);
+        return NULL;
+    }
+    uint8_t (*graph)[*n] = (uint8_t (*)[*n]) calloc(*n * *n, 1);
+    if(graph == NULL) {
+        perror("calloc() failed");
+        return NULL;
     }
-    uint64_t n = strtol(input, NULL, 10);
-    uint8_t (*graph)[n] = (uint8_t (*)[n]) calloc(n * n, 1);
     
-    // read adjacency matrix
-    uint64_t sz = 2*n + 1;
-    char *iptr = malloc(sz);
-    for(uint64_t i = 0; i < n; i++) {
-        ret = fgets(iptr, sz, stdin);
-        if(ret == NULL) {
-            perror("fgets() failed");
-            _exit(1);
-        }
-        for(uint64_t j = 0; j < n; j++) {
-            graph[i][j] = iptr[2*j] - 48;
+    // read adjacency matrix, one character per entry, ignoring whitespace
+    for(uint64_t i = 0; i < *n; i++) {
+        for(uint64_t j = 0; j < *n; j++) {
+            int c;
+            do {
+                c = getc_unlocked(in);
+            } while(c == ' ' || c == '\t' || c == '\r' || c == '\n');
+            
+            if(c == EOF) {
+                fprintf(stderr, "graph ends at [%llu][%llu]\n", i, j);
+                free(graph);
+                return NULL;
+            }
+            graph[i][j] = c - '0';
         }
     }
-    free(iptr);
     
     // check adjacency matrix validity
-    for(uint64_t i = 0; i < n; i++) {
-        for(uint64_t j = 0; j < n; j++) {
+    for(uint64_t i = 0; i < *n; i++) {
+        for(uint64_t j = 0; j < *n; j++) {
             if(graph[i][j] != 0 && graph[i][j] != 1) {
-                printf("graph[%llu][%llu] = %u\n", i, j, graph[i][j]);
-                _exit(1);
+                fprintf(stderr, "graph[%llu][%llu] = %u\n", i, j, graph[i][j]);
+                free(graph);
+                return NULL;
             }
         }
     }
+    
+    return (uint8_t *) graph;
+}
 
-    // ------ connect to prover's UDS ------------------------------------------
 
-    int64_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
-	if(fd < 0) {
-		perror("socket() failed");
-		_exit(1);
-	}
-	
-	struct sockaddr_un server;
-	server.sun_family = AF_UNIX;
-	strncpy(server.sun_path, UDS_NAME, 100);
-	
-	int64_t err = connect(fd, (struct sockaddr *) &server, sizeof(struct sockaddr_un));
-	if(err < 0) {
-		perror("connect() failed");
-		_exit(1);
-	}
+// ------ batch mode -----------------------------------------------------------
+//
+// `verifier -j nthreads [-H hash] [nrounds] < manifest.txt`
+//
+// each manifest line is `graph.txt uds_path`, naming a graph file and the UDS
+// of a prover for it; worker threads pull lines until EOF (so the manifest can
+// be a FIFO fed by a long-running producer) and print one line per job:
+//
+//  `job graph.txt uds_path result latency_ms`
+//
+// where `result` is 0, 1, or `error` if the job never completed the protocol
+// (an unparsable line is reported as `job - - error 0.000`); diagnostics go to
+// stderr so that stdout stays one line per job
+
+static pthread_mutex_t manifest_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t batch_nrounds = NROUNDS_DEFAULT;
+static uint8_t batch_hash = HASH_SHA256;
+static uint64_t njobs = 0;
+
+
+// verify_job(graph_path, uds_path, nrounds, f)
+//  run the whole protocol for one manifest entry
+//  returns 0 or 1 like amplify_verify(), or ABORT on any failure
+
+//  `graph_path`    path of the graph file
+//  `uds_path`      UDS path the prover is listening on
+//  `nrounds`       number of rounds
+//  `f`             digest function to propose
+
+uint8_t verify_job(char *graph_path, char *uds_path, uint64_t nrounds, uint8_t f) {
+
+    FILE *in = fopen(graph_path, "r");
+    if(in == NULL) {
+        perror("fopen() failed");
+        return ABORT;
+    }
     
-    // ------ send graph to prover ---------------------------------------------
+    uint64_t n = 0;
+    uint8_t *graph = read_graph(in, &n);
+    fclose(in);
+    if(graph == NULL) {
+        return ABORT;
+    }
     
-    err = write(fd, &n, sizeof(uint64_t));
-	if(err < 0) {
-		perror("n write() failed");
-		_exit(1);
-	}
+    // a dropped job is resumed from memory, but not across verifier restarts
+    struct checkpoint cp;
+    (void) checkpoint_load(NULL, &cp, n, (uint8_t (*)[n]) graph, nrounds, f);
     
-    err = write(fd, graph, n * n);
-	if(err < 0) {
-		perror("graph write() failed");
-		_exit(1);
-	}
+    uint8_t accept = amplify_verify(uds_path, nrounds, n, (uint8_t (*)[n]) graph, f, &cp, NULL);
+    
+    free(graph);
+    
+    return accept;
+}
+
+
+// batch_worker(arg)
+//  verify manifest entries from stdin until EOF
+
+void *batch_worker(void *arg) {
+
+    (void) arg;
+    char line[1UL << 12];
+    char graph_path[1UL << 12];
+    char uds_path[1UL << 12];
+    
+    while(1) {
+        
+        // take the next job off the manifest
+        pthread_mutex_lock(&manifest_lock);
+        char *ret = fgets(line, sizeof(line), stdin);
+        uint64_t job = njobs;
+        if(ret != NULL) {
+            njobs++;
+        }
+        pthread_mutex_unlock(&manifest_lock);
+        
+        if(ret == NULL) {
+            break;
+        }
+        if(sscanf(line, "%4095s %4095s", graph_path, uds_path) < 2) {
+            fprintf(stderr, "invalid manifest line: %s", line);
+            pthread_mutex_lock(&output_lock);
+            printf("%llu - - error 0.000\n", job);
+            fflush(stdout);
+            pthread_mutex_unlock(&output_lock);
+            continue;
+        }
+        
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint8_t accept = verify_job(graph_path, uds_path, batch_nrounds, batch_hash);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        
+        double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        
+        pthread_mutex_lock(&output_lock);
+        if(accept == ABORT) {
+            printf("%llu %s %s error %.3f\n", job, graph_path, uds_path, ms);
+        }
+        else {
+            printf("%llu %s %s %u %.3f\n", job, graph_path, uds_path, accept, ms);
+        }
+        fflush(stdout);
+        pthread_mutex_unlock(&output_lock);
+    }
+    
+    random_free();
+    hash_free();
+    
+    return NULL;
+}
+
+
+int main(int argc, char **argv) {
+
+    // ------ command line arguments -------------------------------------------
+    
+    uint64_t nthreads = 0;
+    uint8_t hash = hash_fastest(HASH_SHA256);
+    char *cpath = NULL;
+    
+    int opt;
+    while((opt = getopt(argc, argv, "j:H:c:")) != -1) {
+        switch(opt) {
+            case 'j': {
+                nthreads = strtol(optarg, NULL, 10);
+                if(nthreads == 0) {
+                    printf("nthreads must be positive\n");
+                    _exit(1);
+                }
+                break;
+            }
+            case 'H': {
+                hash = hash_lookup(optarg);
+                if(hash == HASH_NONE || !hash_supported(hash)) {
+                    printf("unsupported hash %s\n", optarg);
+                    _exit(1);
+                }
+                break;
+            }
+            case 'c': {
+                cpath = optarg;
+                break;
+            }
+            default: {
+                printf("usage: verifier [-j nthreads] [-H hash] [-c checkpoint] [nrounds]\n");
+                _exit(1);
+            }
+        }
+    }
+    
+    uint64_t nrounds;
+    if(optind >= argc) {
+        nrounds = NROUNDS_DEFAULT;
+    }
+    else {
+        nrounds = strtol(argv[optind], NULL, 10);
+    }
+    
+    hash_select(hash);
+    
+    // a dropped connection should be resumed, not kill the verifier
+    signal(SIGPIPE, SIG_IGN);
+
+    // ------ batch mode -------------------------------------------------------
+    
+    if(nthreads > 0) {
+        batch_nrounds = nrounds;
+        batch_hash = hash_function(hash);
+        
+        // a per-job trace would interleave across threads
+        verbose = 0;
+        
+        pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+        for(uint64_t i = 0; i < nthreads; i++) {
+            int err = pthread_create(&threads[i], NULL, batch_worker, NULL);
+            if(err != 0) {
+                fprintf(stderr, "pthread_create() failed\n");
+                _exit(1);
+            }
+        }
+        for(uint64_t i = 0; i < nthreads; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        
+        return 0;
+    }
+
+    verbose_printf("hash: %s\n\n", hash_names[hash]);
+
+    // ------ read graph from stdin --------------------------------------------
+    
+    uint64_t n = 0;
+    uint8_t *input = read_graph(stdin, &n);
+    if(input == NULL) {
+        _exit(1);
+    }
+    uint8_t (*graph)[n] = (uint8_t (*)[n]) input;
+
+    // ------ resume from the checkpoint, if there is one -----------------------
+    
+    struct checkpoint cp;
+    if(!checkpoint_load(cpath, &cp, n, graph, nrounds, hash_function(hash))) {
+        _exit(1);
+    }
+    if(cp.round > 0 || cp.pending) {
+        verbose_printf("resuming session %016llx at round %llu\n\n", cp.session, cp.round);
+    }
     
     // ------ enter proof protocol ---------------------------------------------
 
-    uint8_t accept = amplify_verify(fd, nrounds, n, graph);
+    uint8_t accept = amplify_verify(UDS_NAME, nrounds, n, graph, hash_function(hash), &cp, cpath);
+    if(accept == ABORT) {
+        _exit(1);
+    }
     printf("%u\n", accept);
     
+    // the proof is finished, so there's nothing left to resume
+    if(cpath != NULL) {
+        unlink(cpath);
+    }
+    
     free(graph);
 
     return 0;
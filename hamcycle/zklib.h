@@ -1,35 +1,72 @@
 // Garrett Tanzer
 // zk library functions
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+#ifdef __x86_64__
+    #include <immintrin.h>
+    #include <cpuid.h>
+#endif
 
 #define UDS_NAME "hamcycle"
 #define NROUNDS_DEFAULT 64
 #define QUEUE 1
 
+// let oversized allocations return NULL under ASan too, so that a graph too big
+// for memory fails cleanly (and in batch mode, fails only its own job)
+const char *__asan_default_options(void) {
+    return "allocator_may_return_null=1";
+}
+
+// largest graph either side accepts, so that n * n * 32 (which bounds every
+// allocation, since d <= n) fits in a uint64_t
+#define NMAX (1UL << 29)
+
+// how often, and how many seconds apart, the verifier retries a dropped session
+#define RECONNECT_TRIES 10
+#define RECONNECT_DELAY 1
+// how many seconds the prover waits for a dropped verifier, with slack over
+// the verifier's retries
+#define RECONNECT_WAIT (2 * RECONNECT_TRIES * RECONNECT_DELAY)
+
+// sent by the verifier in place of a challenge once the last round is done,
+// so it can't be mistaken for b in {0, 1}
+#define PROOF_DONE 0xDD
+
 
 // flag to enable verbose output
+//  `verbose` can also be cleared at runtime (e.g. in batch mode)
 #define VERBOSE 1
+static uint8_t verbose = VERBOSE;
 #if VERBOSE
-    #define verbose_printf printf
+    #define verbose_printf(...) (verbose ? printf(__VA_ARGS__) : 0)
 #else
     #define verbose_printf(fmt, ...) (0)
 #endif
 
 
-static int64_t fd = -1;
-static uint64_t n = 0;
-static uint64_t bufsz = 0;
-static uint8_t *buf = NULL;
+// the /dev/urandom cache is per-thread, so each thread must random_init()
+static __thread int64_t fd = -1;
+static __thread uint64_t n = 0;
+static __thread uint64_t bufsz = 0;
+static __thread uint8_t *buf = NULL;
 
 
 // refill the /dev/urandom cache
@@ -45,20 +82,38 @@ static void buffer_refill(void) {
 
 // must be called before using any other random functions
 //  `sz` is the read cache size
+//  calling it again resizes the cache and reuses the open /dev/urandom
 void random_init(uint64_t sz) {
     bufsz = sz;
     
-    fd = open("/dev/urandom", O_RDONLY);
     if(fd < 0) {
-        perror("urandom open() failed");
-        _exit(1);
+        fd = open("/dev/urandom", O_RDONLY);
+        if(fd < 0) {
+            perror("urandom open() failed");
+            _exit(1);
+        }
     }
     
+    free(buf);
     buf = malloc(bufsz);
     buffer_refill();
 }
 
 
+// release this thread's /dev/urandom cache
+void random_free(void) {
+    if(fd >= 0) {
+        close(fd);
+    }
+    free(buf);
+    
+    fd = -1;
+    buf = NULL;
+    bufsz = 0;
+    n = 0;
+}
+
+
 // return a random 0 or 1
 uint8_t random_flip(void) {
     if(fd < 0) {
@@ -133,8 +188,8 @@ void permute(uint64_t n, uint64_t *permutation) {
     
             // mod by the nearest (rounded up) power of 2 to i,
             // so the distribution is uniform but j > i is unlikely
-            uint64_t logn = sizeof(n) * 8 - __builtin_clzl(n);
-            uint64_t mod = 1UL << logn;
+            uint64_t logi = sizeof(i) * 8 - __builtin_clzl(i);
+            uint64_t mod = 1UL << logi;
             
             j = j % mod;
         }
@@ -145,3 +200,350 @@ void permute(uint64_t n, uint64_t *permutation) {
         permutation[i] = temp;
     }
 }
+
+
+// ------ socket i/o -----------------------------------------------------------
+
+
+// read exactly `len` bytes from `conn` into `dst`
+//  returns 0 if the connection failed or closed first (with errno set)
+uint8_t read_full(int64_t conn, void *dst, uint64_t len) {
+    uint8_t *ptr = dst;
+    while(len > 0) {
+        int64_t nread = read(conn, ptr, len);
+        if(nread == 0) {
+            errno = ECONNRESET;
+        }
+        if(nread <= 0) {
+            if(nread < 0 && errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        ptr += nread;
+        len -= nread;
+    }
+    return 1;
+}
+
+
+// write exactly `len` bytes from `src` to `conn`
+//  returns 0 if the connection failed first (with errno set)
+uint8_t write_full(int64_t conn, void *src, uint64_t len) {
+    uint8_t *ptr = src;
+    while(len > 0) {
+        int64_t nwritten = write(conn, ptr, len);
+        if(nwritten < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        ptr += nwritten;
+        len -= nwritten;
+    }
+    return 1;
+}
+
+
+// ------ commitment layout ----------------------------------------------------
+//
+// each row p of the permuted graph is committed as `d` 32-byte entries, where
+// `d` is the maximum out-degree of the graph (public, since the graph is)
+//
+// an entry is [23 random bytes | 8-byte column q | 1-byte bit]; row p holds one
+// entry with bit 1 for each edge (p, q), padded with bit 0 dummies and shuffled,
+// so opening the matrix costs n * d hashes instead of n * n, while a single
+// edge can still be opened on its own
+
+#define ENTRY_COL 23
+#define ENTRY_BIT 31
+
+
+// return the column stored in `entry`
+uint64_t entry_col(uint8_t *entry) {
+    uint64_t q;
+    memcpy(&q, &entry[ENTRY_COL], sizeof(uint64_t));
+    return q;
+}
+
+
+// store the column `q` in `entry`
+void entry_set_col(uint8_t *entry, uint64_t q) {
+    memcpy(&entry[ENTRY_COL], &q, sizeof(uint64_t));
+}
+
+
+// max_degree(n, graph)
+//  return the row width `d` of the commitment layout for `graph`
+
+//  `n`         number of vertices
+//  `graph`     n x n adjacency matrix
+
+uint64_t max_degree(uint64_t n, uint8_t (*graph)[n]) {
+    uint64_t d = 1;
+    for(uint64_t i = 0; i < n; i++) {
+        uint64_t deg = 0;
+        for(uint64_t j = 0; j < n; j++) {
+            deg += graph[i][j];
+        }
+        if(deg > d) {
+            d = deg;
+        }
+    }
+    return d;
+}
+
+
+// ------ constant-time checks -------------------------------------------------
+
+
+// digest_diff(a, b)
+//  return 0 iff the 256-bit digests `a` and `b` are equal, without branching
+//  on their contents (two 16-byte SIMD compares where SSE2 is available)
+
+uint64_t digest_diff(uint8_t *a, uint8_t *b) {
+#ifdef __SSE2__
+    __m128i lo = _mm_xor_si128(_mm_loadu_si128((__m128i *) a), _mm_loadu_si128((__m128i *) b));
+    __m128i hi = _mm_xor_si128(_mm_loadu_si128((__m128i *) (a + 16)), _mm_loadu_si128((__m128i *) (b + 16)));
+    __m128i eq = _mm_cmpeq_epi8(_mm_or_si128(lo, hi), _mm_setzero_si128());
+    return _mm_movemask_epi8(eq) ^ 0xFFFF;
+#else
+    uint64_t diff = 0;
+    for(uint64_t k = 0; k < 32; k += 8) {
+        uint64_t x, y;
+        memcpy(&x, &a[k], sizeof(uint64_t));
+        memcpy(&y, &b[k], sizeof(uint64_t));
+        diff |= x ^ y;
+    }
+    return diff;
+#endif
+}
+
+
+// return `c` ? `a` : `b` without branching, for `c` in {0, 1}
+uint64_t ct_select(uint64_t c, uint64_t a, uint64_t b) {
+    uint64_t mask = -c;
+    return (a & mask) | (b & ~mask);
+}
+
+
+// ------ hash backends --------------------------------------------------------
+//
+// every commitment hashes a 32-byte entry to a 32-byte digest through `hash32`
+//
+// the verifier proposes a digest function after sending the graph and the
+// prover echoes it back (or HASH_NONE); sha256 and sha256-ni compute the same
+// function, so each side picks whichever of them it runs fastest
+
+#define HASH_SHA256 0       // SHA-256 via OpenSSL
+#define HASH_SHA256_NI 1    // SHA-256 as one block on the x86 SHA extensions
+#define HASH_BLAKE2S 2      // BLAKE2s-256 via OpenSSL
+#define NHASHES 3
+#define HASH_NONE 0xFF
+
+static char *hash_names[NHASHES] = {"sha256", "sha256-ni", "blake2s"};
+
+
+// the OpenSSL implementations are fetched once, rather than on every call as
+// SHA256() does; each thread keeps its own context
+static EVP_MD *sha256_md = NULL;
+static EVP_MD *blake2s_md = NULL;
+static __thread EVP_MD_CTX *evp_ctx = NULL;
+
+
+// hash_evp(md, in, out)
+//  hash a 32-byte entry with the fetched OpenSSL digest `md`
+
+void hash_evp(EVP_MD *md, uint8_t *in, uint8_t *out) {
+    if(evp_ctx == NULL) {
+        evp_ctx = EVP_MD_CTX_new();
+    }
+    
+    if(!EVP_DigestInit_ex(evp_ctx, md, NULL) || !EVP_DigestUpdate(evp_ctx, in, 32) || !EVP_DigestFinal_ex(evp_ctx, out, NULL)) {
+        printf("%s failed\n", EVP_MD_get0_name(md));
+        _exit(1);
+    }
+}
+
+
+void hash_sha256(uint8_t *in, uint8_t *out) {
+    if(sha256_md == NULL) {
+        sha256_md = EVP_MD_fetch(NULL, "SHA256", NULL);
+    }
+    hash_evp(sha256_md, in, out);
+}
+
+
+#ifdef __x86_64__
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+// SHA-256 of a 32-byte message, which pads to exactly one block, so there is no
+// buffering and the second half of the message schedule is constant
+__attribute__((target("sha,sse4.1")))
+void hash_sha256_ni(uint8_t *in, uint8_t *out) {
+
+    // byte-swap each 32-bit word
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    
+    // initial hash value, arranged as ABEF / CDGH for sha256rnds2
+    __m128i state0 = _mm_set_epi32(0x6a09e667, 0xbb67ae85, 0x510e527f, 0x9b05688c);
+    __m128i state1 = _mm_set_epi32(0x3c6ef372, 0xa54ff53a, 0x1f83d9ab, 0x5be0cd19);
+    __m128i abef = state0;
+    __m128i cdgh = state1;
+    
+    // message words 0-7 are the input, 8-15 are the padding for a 256-bit message
+    __m128i w[4];
+    w[0] = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) in), bswap);
+    w[1] = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (in + 16)), bswap);
+    w[2] = _mm_set_epi32(0, 0, 0, 0x80000000);
+    w[3] = _mm_set_epi32(0x00000100, 0, 0, 0);
+    
+    // fully unrolled, so the `w` indices and the `g >= 4` test are resolved at compile time
+    #pragma GCC unroll 16
+    for(uint64_t g = 0; g < 16; g++) {
+        if(g >= 4) {
+            __m128i x = _mm_sha256msg1_epu32(w[g % 4], w[(g+1) % 4]);
+            x = _mm_add_epi32(x, _mm_alignr_epi8(w[(g+3) % 4], w[(g+2) % 4], 4));
+            w[g % 4] = _mm_sha256msg2_epu32(x, w[(g+3) % 4]);
+        }
+        
+        __m128i msg = _mm_add_epi32(w[g % 4], _mm_loadu_si128((__m128i *) &sha256_k[4*g]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+    }
+    
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+    
+    // rearrange ABEF / CDGH back to ABCD / EFGH, big-endian
+    __m128i feba = _mm_shuffle_epi32(state0, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(state1, 0xB1);
+    __m128i dcba = _mm_blend_epi16(feba, dchg, 0xF0);
+    __m128i hgfe = _mm_alignr_epi8(dchg, feba, 8);
+    
+    _mm_storeu_si128((__m128i *) out, _mm_shuffle_epi8(dcba, bswap));
+    _mm_storeu_si128((__m128i *) (out + 16), _mm_shuffle_epi8(hgfe, bswap));
+}
+
+#endif
+
+
+void hash_blake2s(uint8_t *in, uint8_t *out) {
+    hash_evp(blake2s_md, in, out);
+}
+
+
+static void (*hash32)(uint8_t *in, uint8_t *out) = hash_sha256;
+
+
+// hash_function(id)
+//  return the id of the digest function computed by backend `id` (for the handshake)
+
+uint8_t hash_function(uint8_t id) {
+    return id == HASH_SHA256_NI ? HASH_SHA256 : id;
+}
+
+
+// hash_lookup(name)
+//  return the id of the backend called `name`, or HASH_NONE
+
+uint8_t hash_lookup(char *name) {
+    for(uint8_t id = 0; id < NHASHES; id++) {
+        if(strcmp(name, hash_names[id]) == 0) {
+            return id;
+        }
+    }
+    return HASH_NONE;
+}
+
+
+// hash_supported(id)
+//  return 1 iff backend `id` can run on this machine
+
+uint8_t hash_supported(uint8_t id) {
+    switch(id) {
+        case HASH_SHA256: {
+            if(sha256_md == NULL) {
+                sha256_md = EVP_MD_fetch(NULL, "SHA256", NULL);
+            }
+            return sha256_md != NULL;
+        }
+        case HASH_SHA256_NI: {
+#ifdef __x86_64__
+            uint32_t a, b, c, d;
+            return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_SHA) && __builtin_cpu_supports("sse4.1");
+#else
+            return 0;
+#endif
+        }
+        case HASH_BLAKE2S: {
+            if(blake2s_md == NULL) {
+                blake2s_md = EVP_MD_fetch(NULL, "BLAKE2S-256", NULL);
+            }
+            return blake2s_md != NULL;
+        }
+        default: {
+            return 0;
+        }
+    }
+}
+
+
+// hash_fastest(f)
+//  return the fastest supported backend computing digest function `f`, or HASH_NONE
+
+uint8_t hash_fastest(uint8_t f) {
+    if(f == HASH_SHA256 && hash_supported(HASH_SHA256_NI)) {
+        return HASH_SHA256_NI;
+    }
+    return f < NHASHES && hash_function(f) == f && hash_supported(f) ? f : HASH_NONE;
+}
+
+
+// hash_select(id)
+//  point `hash32` at backend `id`
+//  must be called before any other threads hash
+
+void hash_select(uint8_t id) {
+    switch(id) {
+        case HASH_SHA256: {
+            (void) hash_supported(HASH_SHA256);
+            hash32 = hash_sha256;
+            break;
+        }
+#ifdef __x86_64__
+        case HASH_SHA256_NI: {
+            hash32 = hash_sha256_ni;
+            break;
+        }
+#endif
+        case HASH_BLAKE2S: {
+            hash32 = hash_blake2s;
+            break;
+        }
+        default: {
+            printf("unsupported hash %u\n", id);
+            _exit(1);
+        }
+    }
+}
+
+
+// release this thread's hash state
+void hash_free(void) {
+    EVP_MD_CTX_free(evp_ctx);
+    evp_ctx = NULL;
+}